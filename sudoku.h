@@ -17,6 +17,22 @@
 #include <map>
 #include <string>
 #include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <array>
+#include <list>
+#include <unordered_map>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // Some names from std to be used in the code frequently.
 using std::cout;	
@@ -32,15 +48,19 @@ struct BadValue {};
 struct NoInputFile {};
 struct InvalidPuzzle {};
 
+// Classes for the board and solvers are templates on the size of the box
+// (B: 2 to 8), so that the geometry of the board is known at compile time.
+// The instantiation for a puzzle is chosen at runtime by createSudoku.
+
 // Class that represents the position of the board (or grid).
-// 	For example, for 9x9 board, the position is represented by (r,c) 
-// 	where r: row number (0<=r<=sizeR-1), c: col number (0<=c<=sizeC)
-class Pos {
+// 	For example, for 9x9 board (B = 3), the position is represented by 
+// 	(r,c) where r: row number (0<=r<=size-1), c: col number (0<=c<=size-1)
+template <short B> class Pos {
    public :
    	// Constructor.
 	Pos() : r(0), c(0) {};
 	Pos(short x, short y)
-		: r(x % sizeR), c(y % sizeC) {}; // r & c in range always.
+		: r(x % size), c(y % size) {}; // r & c in range always.
 	// Destructor.
 	~Pos() {};
 
@@ -49,52 +69,251 @@ class Pos {
 		std::cout << '(' << r << ',' << c << ")\n";
 	};
 
-	// Sets the size of the board.
-	static void setSize(short sR, short sC) {
-		if (sR < 4 || sC < 4 || sR > 100 || sC > 100) throw BadSize();
-		sizeR = sR;
-		sizeC = sC;
-	};
-
    public : // public, to access the point values easier.
    	short r, c; 
-	static short sizeR, sizeC; // size of the board: sizeR x sizeC.
-				// In Sudoku puzzles, sizeR = sizeC always.	
+	static const short size = B * B; // size of the board: size x size.
 };
 
-// Initializes static variables of Pos class(can be changed later using setSize)
-short Pos::sizeR = 9; 
-short Pos::sizeC = 9;
-
 // A class that defines the "less than" function for the Pos class
 // Needed because Pos will  be used as keys for a map container.
 // The row-wise order: (0,0), (0,1), ..., (1,0), (1,1), (1,2), ...
-class PosLessThan {
+template <short B> class PosLessThan {
    public :
-	inline bool operator() (const Pos & p1, const Pos & p2) {
+	inline bool operator() (const Pos<B> & p1, const Pos<B> & p2) const {
 		return (p1.c==p2.c ? p1.r < p2.r : p1.c < p2.c);
 	};
 };
 
+// Type for a set of values (bit v-1 is set if the value v is in the set).
+// 	64 bits are enough for boards up to 64x64 (sizeBox <= 8).
+typedef unsigned long long Mask;
+
+// Returns the number of values in a given set.
+inline short countValues(Mask m) {return __builtin_popcountll(m);}
+
+// Returns the smallest value in a given non-empty set.
+inline unsigned char lowestValue(Mask m) {return __builtin_ctzll(m) + 1;}
+
+// Returns the set that only has the value v.
+inline Mask valueMask(unsigned char v) {return Mask(1) << (v - 1);}
+
+// The largest size of the box for lines (see Board::readLine): values 
+// of larger boards (36 and more) have no characters.
+const short maxLineSizeBox = 5;
+
+// Returns the value of a character in a line (see Board::readLine): 0 for
+// empty ('0' or '.'), 1 to 35, or -1 if it is not a value.
+inline short valueOfChar(char ch) {
+	if (ch == '0' || ch == '.') return 0;
+	else if (ch >= '1' && ch <= '9') return ch - '0';
+	else if (ch >= 'A' && ch <= 'Z') return ch - 'A' + 10;
+	else if (ch >= 'a' && ch <= 'z') return ch - 'a' + 10;
+	else return -1;
+}
+
+// Returns the character of a value (0 to 35) in a line.
+inline char charOfValue(short v) {
+	return (v < 10 ? char('0' + v) : char('A' + v - 10));
+}
+
+// Read-only memory-mapped file, so that a file is parsed directly from
+// memory without copying or allocating anything.
+class MappedFile {
+   public:
+	// Constructor. Throws NoInputFile if the file can't be opened.
+	// Files that can't be mapped (pipes, such as /dev/stdin) are read 
+	// into memory instead.
+	MappedFile(string filename);
+	// Destructor.
+	~MappedFile();
+
+	// Returns the contents of the file (0 if the file is empty).
+	const char *getData() const {return data;};
+
+	// Returns the size of the file in bytes.
+	size_t getSize() const {return size;};
+
+   private:
+	// Not copied (the mapping is unmapped once).
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	const char *data; // the mapped contents.
+	size_t size; // size of the file.
+	bool mapped; // false if the contents are read into 'contents'.
+	vector<char> contents;
+};
+
+// Writer to a file through a large buffer, so that many small pieces 
+// (such as lines or cells) are written at once.
+class BufferedWriter {
+   public:
+	// Constructor.
+	// 	capacity: size of the buffer in bytes.
+	BufferedWriter(string filename, size_t capacity = 1 << 20)
+		: out(filename.c_str(), std::ios::out | std::ios::binary), \
+		buffer(capacity), used(0) {};
+	// Destructor (the rest of the buffer is written).
+	~BufferedWriter() {flush();};
+
+	// Writes n bytes.
+	void write(const char *data, size_t n) {
+		if (used + n > buffer.size()) {
+			flush();
+			// Too large for the buffer: written directly.
+			if (n > buffer.size()) {
+				out.write(data, n);
+				return;
+			};
+		};
+		std::copy(data, data + n, buffer.begin() + used);
+		used += n;
+	};
+
+	// Writes a string.
+	void write(const string &text) {write(text.data(), text.size());};
+
+	// Writes a character.
+	void put(char ch) {
+		if (used == buffer.size()) flush();
+		buffer[used++] = ch;
+	};
+
+	// Writes the buffer to the file.
+	void flush() {
+		out.write(buffer.data(), used);
+		used = 0;
+	};
+
+   private:
+	std::ofstream out; // the file.
+	vector<char> buffer; // the buffer,
+	size_t used; // 	and the number of bytes used in it.
+};
+
+// Packed binary format for many puzzles (or solutions) of the same size:
+// 	a header of 8 bytes ('S', 'D', 'K', 'P', the size of the box, bits 
+// 	per cell, and two zeros), and a record for each puzzle, where values 
+// 	of cells (row-wise, 0 for empty) are packed with the bits per cell
+// 	(4 bits for 9x9 boards, 41 bytes), starting from the lowest bits.
+const size_t packedHeaderSize = 8;
+
+// Returns the number of bits per cell in the packed format.
+inline short getBitsPerCell(short sizeBox) {
+	short bits = 1;
+	while ((1 << bits) <= sizeBox * sizeBox) bits++;
+	return bits;
+}
+
+// Returns the size of a record in the packed format in bytes.
+inline size_t getPackedSize(short sizeBox) {
+	return (size_t(sizeBox) * sizeBox * sizeBox * sizeBox * \
+		getBitsPerCell(sizeBox) + 7) / 8;
+}
+
+// Writes the header of the packed format.
+void writePackedHeader(BufferedWriter &out, short sizeBox);
+
+// Packs a puzzle in a line (see Board::readLine, without checking the 
+// rules) into a record. Throws BadInput if a character is not a value.
+void packPuzzle(const char *line, short sizeBox, unsigned char *record);
+
+// Unpacks a record into a line (sizeBox^4 characters). Values too large 
+// for the board are written as '?' (not a value).
+void unpackPuzzle(const unsigned char *record, short sizeBox, char *line);
+
+// File of puzzles read through a memory-mapped file: one puzzle per line
+// (see Board::readLine), or the packed format (found from the header).
+// Puzzles are given as pointers into the file, without copying.
+class PuzzleFile {
+   public:
+	// Constructor. Throws NoInputFile if the file can't be opened, and 
+	// BadInput (or BadSize) if the header of the packed format is wrong.
+	PuzzleFile(string filename);
+
+	// Returns true if the file has the packed format.
+	bool ifPacked() const {return packed;};
+
+	// Returns the size of the box of puzzles: given by the header of the 
+	// packed format, or found from the first line of a valid length (0 if
+	// there is none).
+	short getSizeBox() const {return sizeBox;};
+
+	// Gets the next puzzle (a line without the end of line, or a record),
+	// and returns false at the end of the file. Empty lines are skipped.
+	bool next(const char *&puzzle, size_t &length);
+
+	// Gets a puzzle given by 'next' as a line (unpacked if packed).
+	void getLine(const char *puzzle, size_t length, string &line) const;
+
+   private:
+	MappedFile file; // the file.
+	bool packed; // true for the packed format.
+	short sizeBox; // size of the box of puzzles.
+	size_t position; // position of the next puzzle in the file.
+};
+
+// Converts a file of puzzles between lines and the packed format (to the 
+// packed format if the input has lines, and to lines if it is packed).
+// Returns the number of puzzles converted.
+long convertPuzzles(string inFilename, string outFilename);
+
+// Returns the size of the box for the puzzle in a csv file, 
+// found from the number of rows (0 if it is not a valid size).
+short getSizeBoxOfFile(string filename);
+
+// Returns the size of the box for the puzzle in a line (see Board::readLine),
+// found from its length (0 if it is not a valid size).
+short getSizeBoxOfLine(const string &line);
+
+// Makes a random puzzle with the box size sizeBox and nGivens values of
+// a random solution, as a line (see Board::readLine).
+void generatePuzzle(short sizeBox, short nGivens, std::mt19937 &random, \
+	string &line);
+
+// Tables for the geometry of the board with the box size B, which are
+// computed at compile time: the box of each cell, cells in each unit 
+// (rows: 0 to size-1, columns: size to 2size-1, and boxes: 2size to 
+// 3size-1), and the units of each cell (its row, column, and box).
+template <short B> struct Geometry {
+	static const short size = B * B; // size of the board.
+	static const short nCells = size * size; // number of cells.
+	constexpr Geometry(): box(), units(), unitOf() {
+		for (short r = 0; r < size; r++)
+			for (short c = 0; c < size; c++) {
+				short i = r*size + c, b = (r / B) * B + c / B;
+				box[i] = b;
+				units[r][c] = units[size + c][r] = i;
+				units[2*size + b][(r % B) * B + c % B] = i;
+				unitOf[0][i] = r;
+				unitOf[1][i] = size + c;
+				unitOf[2][i] = 2*size + b;
+			};
+	};
+	short box[nCells]; // box number of each cell (row-wise).
+	short units[3 * size][size]; // cells in each unit.
+	short unitOf[3][nCells]; // row, column, and box units of each cell.
+};
+
+// Geometry tables for each size of the box (made at compile time).
+template <short B> constexpr Geometry<B> geometry = Geometry<B>();
+
 // Class that represents a board for Sudoku.
-// The size of the board can be set by the user (default: 9x9).
+// The size of the board is given by the size of the box B (B=3: 9x9).
 // Values at cells are represented by the type 'unsigned char',
 // 	(0 means empty, and numbers between 1 and size will be used as values.)
-// Two arrays will be used to store board information: for value and emptiness.
-class Board {
+// Cells are stored in a flat array (row-wise), and the sets of values 
+// already used in each row, column and box are kept as bit masks, 
+// 	so that conflict checks and candidates are simple mask operations.
+// All arrays have fixed sizes.
+template <short B> class Board {
    public:
-	// Constructor.
-	// n^2 will be the size of the board. (Assumed 2 <= n <= 10)
-	// For example, for n = 3 (default), 9x9 board will be used.
-	Board(short n = 3): sizeBox(n), size(n*n), board(n*n), empty(n*n), \
-		nEmpty(n*n*n*n) { // All cells are empty in the beginning.
-		Pos::setSize(size, size); // Setting the size for the Pos class.
-		// Initializing arrays (assuming every cell is empty).
-		for (short i = 0; i < size; i++) {
-			board[i].resize(size);
-			empty[i].resize(size);
-			for (short j = 0; j < size; j++) empty[i][j] = true;
-		};
+	static const short sizeBox = B; // size of the box (2 <= B <= 8).
+	static const short size = B * B; // size of the board (size x size).
+
+	// Constructor (all cells are empty).
+	Board(): nEmpty(size * size), cells(), rowUsed(), colUsed(), boxUsed() {
+		static_assert(B >= 2 && B <= 8, "Masks have only 64 bits.");
 	};
 
 	// Returns the size of the box of the board (=sqrt(size)).
@@ -114,62 +333,82 @@ class Board {
 	// (Uses the same format as input.)
 	void write(string filename) const;
 
+	// Initializes the board from a line with one character per cell 
+	// (row-wise), such as the common 81-character format for 9x9 boards.
+	// '0' or '.' means empty, and values 10 to 35 are given as 'A' to 'Z'.
+	// Lines are used only for boards up to 25x25 (BadSize is thrown).
+	void readLine(const char *line, size_t length);
+	void readLine(const string &line) {readLine(line.data(), line.size());};
+
+	// Appends current contents of the board to a string as a line.
+	// (Uses the same format as 'readLine'.)
+	void writeLine(string &line) const;
+
+	// Makes all cells empty.
+	void clear();
+
 	// Returns the value of a cell (r,c)
-	unsigned char get(short r, short c) const {return board[r][c];};
+	unsigned char get(short r, short c) const {return cells[r*size + c];};
 
 	// Sets the value of a cell (r,c) to v.
 	void set(short r, short c, unsigned char v);
 
 	// Returns true if the given cell (r,c) is empty (false if not).
-	bool ifEmpty(short r, short c) const {return empty[r][c];}
+	bool ifEmpty(short r, short c) const {return cells[r*size + c] == 0;}
 
 	// Makes a given cell empty.
 	void makeEmpty(short r, short c) {
-		if (!ifEmpty(r,c)) { // Only when the cell is not empty.
-			empty[r][c] = true;
+		short i = r*size + c;
+		if (cells[i] != 0) { // Only when the cell is not empty.
+			Mask m = ~valueMask(cells[i]);
+			rowUsed[r] &= m;
+			colUsed[c] &= m;
+			boxUsed[geometry<B>.box[i]] &= m;
+			cells[i] = 0;
 			nEmpty++;
 		};
 	};		
 
+	// Returns the box number of the cell (r,c) 
+	// 	(boxes are numbered row-wise, starting from 0).
+	short getBox(short r, short c) const {
+		return geometry<B>.box[r*size + c];
+	};
+
+	// Returns the set of all values (1 to size).
+	Mask getAllValues() const {
+		return (size == 64 ? ~Mask(0) : (Mask(1) << (size % 64)) - 1);
+	};
+
+	// Returns the set of values that can be put in the given empty 
+	// cell (r,c) without any conflict with other cells.
+	Mask getCandidates(short r, short c) const {
+		return getAllValues() & ~(rowUsed[r] | colUsed[c] | \
+			boxUsed[geometry<B>.box[r*size + c]]);
+	};
+
 	// Returns true if the value v of the given empty cell (r,c) 
 	// has any conflict with other cells in the same row.
-	bool ifRowConflict(short r, short c, unsigned char v) const {
-		for (short j = 0; j < size; j++)
-			// For non-empty same-row cells.
-			if (!ifEmpty(r,j) && j != c && board[r][j] == v)
-				return true;
-		return false;
+	bool ifRowConflict(short r, short, unsigned char v) const {
+		return (rowUsed[r] & valueMask(v)) != 0;
 	}
 
 	// Returns true if the value v of the given empty cell (r,c) 
 	// has any conflict with other cells in the same column.
-	bool ifColConflict(short r, short c, unsigned char v) const {
-		for (short i = 0; i < size; i++)
-			// For non-empty same-col cells.
-			if (!ifEmpty(i,c) && i != r && board[i][c] == v)
-				return true;
-		return false;
+	bool ifColConflict(short, short c, unsigned char v) const {
+		return (colUsed[c] & valueMask(v)) != 0;
 	}
 
 	// Returns true if the value v of the given empty cell (r,c) 
 	// has any conflict with other cells in the same box (region).
 	bool ifBoxConflict(short r, short c, unsigned char v) const {
-		// Starting row & col number for the box of the given cell.
-		short rBox0 = r - r % sizeBox;
-		short cBox0 = c - c % sizeBox;
-		for (short i = rBox0; i < rBox0 + sizeBox; i++) 
-			for (short j = cBox0; j < cBox0 + sizeBox; j++) 
-				if (!ifEmpty(i,j) && i != r && j != c \
-					&& board[i][j] == v) 
-					return true;
-		return false;
+		return (boxUsed[geometry<B>.box[r*size + c]] & valueMask(v)) != 0;
 	}
 
 	// Returns true if the value v of the given empty cell (r,c) 
 	// has any conflict with other cells in the same row or col or box.
 	bool ifAnyConflict(short r, short c, unsigned char v) const {
-		return (ifRowConflict(r,c,v) || ifColConflict(r,c,v) || \
-			ifBoxConflict(r,c,v));
+		return (getCandidates(r,c) & valueMask(v)) == 0;
 	};
 
 	// Checks if a given board has any conflict for non-empty cells,
@@ -181,14 +420,271 @@ class Board {
 	bool ifValid() const;
 
    private:
-	vector< vector<unsigned char> > board; // 2D array representing board.
-	vector< vector<bool> > empty; 	// 2D array for emptiness of cells 
-					//	(true if empty).
-	short sizeBox; // size of the box (region) inside the board.
-   	short size; // size of the board (size x size).
 	short nEmpty; // number of empty cells.
+	std::array<unsigned char, size * size> cells; // flat array 
+				// representing board (row-wise, 0 if empty).
+	std::array<Mask, size> rowUsed; // sets of values used in each row,
+	std::array<Mask, size> colUsed; //	column,
+	std::array<Mask, size> boxUsed; //	and box.
 };		
 
+// Class that deduces values of empty cells from the rules (constraint 
+// propagation), which can be used by solvers after every assignment.
+// Three rules are applied repeatedly until nothing changes:
+// 1, Naked single: an empty cell with only one possible value gets it.
+// 2, Hidden single: a value that can be put in only one cell of a row,
+// 	column, or box is put there.
+// 3, Locked candidates: if a value in a box can only be in one row (or 
+// 	column), it is eliminated from the rest of the row (pointing), and if 
+// 	a value in a row (or column) can only be in one box, it is eliminated 
+// 	from the rest of the box (claiming).
+// All changes (values set and eliminated) are recorded in a trail, so that
+// they can be undone on backtracking.
+template <short B> class Propagator {
+   public:
+	// Constructor.
+	// The trail is allocated here for the most changes it can have (each 
+	// cell is set once, and loses each value once), so that nothing is 
+	// allocated during the search.
+	Propagator(): removed(), trail(), rowSegments(), colSegments() {
+		trail.reserve(size * size * (size + 1));
+	};
+
+	// Starts again for a new puzzle (nothing is eliminated).
+	void clear();
+
+	// Returns the set of values not eliminated at the cell (r,c).
+	Mask getAllowed(short r, short c) const {
+		return ~removed[r*size + c];
+	};
+
+	// Applies all rules to the board until nothing changes.
+	// Returns false if a contradiction is found (an empty cell, or
+	// a value in a row, column, or box has no possibility).
+	bool propagate(Board<B> &board);
+
+	// Returns the current position of the trail.
+	size_t mark() const {return trail.size();};
+
+	// Undoes all changes made after the given position of the trail.
+	void undo(Board<B> &board, size_t mark);
+
+   private:
+	// Returns the possible values of an empty cell (i: r*size+c).
+	Mask getCandidates(const Board<B> &board, short i) const {
+		return board.getCandidates(i / size, i % size) & ~removed[i];
+	};
+
+	// Sets the value v at the cell i (recorded in the trail).
+	void assign(Board<B> &board, short i, unsigned char v);
+
+	// Eliminates values in m from the cell i (recorded in the trail).
+	// Returns true if any value is actually eliminated.
+	bool eliminate(const Board<B> &board, short i, Mask m);
+
+	// Each rule returns false if a contradiction is found, and 
+	// changed becomes true if anything changes.
+	bool applyNakedSingles(Board<B> &board, bool &changed);
+	bool applyHiddenSingles(Board<B> &board, bool &changed);
+	bool applyLockedCandidates(Board<B> &board, bool &changed);
+
+	// Eliminates values in m from the cells in the unit u, except for 
+	// the cells also in the unit 'except'. Returns true if any is done.
+	bool eliminateInUnit(const Board<B> &board, short u, short except, \
+		Mask m);
+
+   private:
+	// A change in the trail: values eliminated at a cell, or the value 
+	// set at a cell (if 'values' is 0).
+	struct Change {
+		short cell;
+		Mask values;
+	};
+	static const short sizeBox = B; // size of the box (region).
+	static const short size = B * B; // size of the board (size x size).
+	std::array<Mask, size * size> removed; // values eliminated at each cell.
+	vector<Change> trail; // all changes in the order.
+	// Cells in units, and units of cells are found from geometry<B>.
+	// Possible values in the intersection of each row (or column) and 
+	// each box crossing it (index: row*sizeBox + box number in the row).
+	typedef std::array<Mask, size * sizeBox> Segments;
+	Segments rowSegments, colSegments;
+};
+
+// Symmetry of Sudoku that transforms a board (B: size of the box): the 
+// board is transposed (optionally), then rows and columns are reordered,
+// keeping rows of a band (and columns of a stack) together, and values 
+// are relabeled. Any puzzle transformed this way has the same number of
+// solutions, transformed in the same way.
+template <short B> struct Transform {
+	static const short size = B * B; // size of the board.
+	bool transposed; // true if the board is transposed first.
+	// rows[i] (cols[j]): row (column) of the board moved to the row i
+	// (column j), and labels[v]: new value of the value v (labels[0]=0).
+	std::array<unsigned char, size> rows, cols;
+	std::array<unsigned char, size + 1> labels;
+
+	// Appends the transformed board to a string as a line (see 
+	// Board::readLine).
+	void apply(const Board<B> &board, string &line) const;
+
+	// Sets the board from a line of a transformed board (the inverse).
+	// Returns false if the line is not a board of this size.
+	bool applyInverse(const string &line, Board<B> &board) const;
+};
+
+// Finds the canonical form of a puzzle: the smallest line (see 
+// Board::readLine) of all boards transformed by symmetries, where values
+// are relabeled in the order they appear (so that the same puzzle is 
+// found for all symmetric puzzles). The transform to it is returned, too.
+// Returns false if it is too costly (boards larger than 16x16, or too 
+// many symmetric choices, as in almost empty boards).
+template <short B> \
+bool canonicalize(const Board<B> &board, Transform<B> &transform, \
+	string &line);
+
+// Search for the canonical form of a puzzle (see canonicalize). Orders 
+// of columns (with the board transposed or not) are chosen stack by 
+// stack, and cut when the first row of the form gets larger than the 
+// best. For each order, rows of the form are chosen one by one: the row
+// with the smallest labeled values among rows that can be put there (all
+// rows with the smallest are tried), and the search is cut as soon as 
+// the form gets larger than the best.
+template <short B> class Canonicalizer {
+   public:
+	// Constructor.
+	Canonicalizer(): grid(), emptyRow(), usedRow(), usedStack(), \
+		current(), best(), form(), bestForm(), nextLabel(), found(false), \
+		lessFrom(), steps() {};
+
+	// Finds the canonical form (see canonicalize).
+	bool run(const Board<B> &board, Transform<B> &transform, string &line);
+
+   private:
+	static const short size = B * B; // size of the board.
+	static const long maxSteps = 200000; // limit of steps of the search.
+
+	// Chooses the stack s of the form, and the order of its columns.
+	void searchColumns(short s);
+
+	// Returns true if the first nCols columns of all rows (labeled) are 
+	// larger than the first row of the best form.
+	bool ifLargerRows(short nCols) const;
+
+	// Chooses the row i of the form for the current order of columns.
+	void searchRows(short i);
+
+	// Labels the values of the row r of the board in the order of columns 
+	// (values not labeled yet get new labels), and compares it with 
+	// 'bound' (0: not compared). Returns 1 if it is larger (and stops 
+	// there), and -1 (smaller) or 0 (equal) otherwise.
+	short labelRow(short r, const unsigned char *bound, \
+		unsigned char *row) const;
+
+	std::array<unsigned char, size * size> grid; // board (transposed or not)
+	std::array<bool, size> emptyRow; // true if a row of the board is empty,
+	std::array<bool, size> usedRow; // 	and true if it is in the form.
+	std::array<bool, B> usedStack; // true if a stack is in the form.
+	Transform<B> current, best; // current and best transforms,
+	std::array<unsigned char, size * size> form, bestForm; // 	and forms.
+	unsigned char nextLabel; // label for the next new value.
+	bool found; // true if the best form is found.
+	short lessFrom; // first row where the form is smaller than the best.
+	long steps; // steps of the search.
+};
+
+// Bounded cache of solutions of canonical puzzles (see canonicalize), 
+// shared by all threads. When it is full, the least recently used 
+// solution is removed. It can be saved to a file and loaded again.
+class SolutionCache {
+   public:
+	// Constructor.
+	// 	capacity: the maximum number of puzzles kept.
+	SolutionCache(size_t capacity)
+		: entries(), index(), capacity(capacity), lock(), hits(0), \
+		lookups(0) {};
+
+	// Finds the solution of a canonical puzzle (empty if it has no 
+	// solution). Returns false if the puzzle is not in the cache.
+	bool find(const string &puzzle, string &solution);
+
+	// Puts the solution of a canonical puzzle (empty if it has no 
+	// solution) to the cache.
+	void insert(const string &puzzle, const string &solution);
+
+	// Removes a canonical puzzle from the cache (if it is there).
+	void erase(const string &puzzle);
+
+	// Returns the number of puzzles in the cache.
+	size_t getSize();
+
+	// Returns the numbers of puzzles found, and of all lookups.
+	long long getHits() const {return hits;};
+	long long getLookups() const {return lookups;};
+
+	// Returns the rate of puzzles found (0 if no lookups).
+	double getHitRate() const {
+		long long n = lookups;
+		return (n > 0 ? double(hits) / n : 0);
+	};
+
+	// Loads puzzles from a file saved by 'save' (nothing is done if the 
+	// file does not exist).
+	void load(string filename);
+
+	// Saves all puzzles with solutions to a file: one puzzle per line 
+	// with its solution ('puzzle,solution'), from the least recently used.
+	// Puzzles without solutions are not saved, since they can't be checked
+	// when loaded (they are kept only while the program runs).
+	void save(string filename);
+
+   private:
+	// Puzzles and solutions from the most recently used.
+	typedef std::list< std::pair<string, string> > Entries;
+	Entries entries;
+	std::unordered_map<string, Entries::iterator> index; // for puzzles.
+	size_t capacity; // the maximum number of puzzles.
+	std::mutex lock; // Lock for all changes.
+	std::atomic<long long> hits, lookups; // numbers of lookups.
+};
+
+// Statistics of the search for a puzzle. Only the number of nodes is 
+// always counted; other counters and timers are compiled only if 
+// SUDOKU_STATS is defined (g++ -DSUDOKU_STATS ...), so that they cost 
+// nothing otherwise, and the trace of the search can be written then, too.
+#ifdef SUDOKU_STATS
+#define STATS(x) x
+#else
+#define STATS(x)
+#endif
+
+struct SearchStats {
+	SearchStats(): nodes(), backtracks(), conflictChecks(), candidates(), \
+		maxDepth(), nextCellSeconds(), solveSeconds() {};
+	long long nodes; // nodes (recursive steps) visited.
+	long long backtracks; // values (or rows) undone after they failed.
+	long long conflictChecks; // sets of possible values of cells found.
+	long long candidates; // values (or rows) tried.
+	short maxDepth; // maximum depth of the search.
+	double nextCellSeconds; // time to find next cells (or columns),
+	double solveSeconds; // 	and the time of the whole search.
+};
+
+// Adds the time from its construction to its destruction to a variable
+// (in seconds), to time a block of code.
+class StatsTimer {
+   public:
+	StatsTimer(double &t): total(t), start(std::chrono::steady_clock::now())
+		{};
+	~StatsTimer() {
+		total += std::chrono::duration<double>( \
+			std::chrono::steady_clock::now() - start).count();
+	};
+   private:
+	double &total;
+	std::chrono::steady_clock::time_point start;
+};
+
 // Class to solve sudoku puzzles using the recursive backtracking algorithm.
 // Three different heuristics will be used to find next empty cells 
 // for recursions, and they will be represented by 3 derived classes.
@@ -202,28 +698,289 @@ class Board {
 // 3, Find all possible numbers for all empty cells at each step, and
 // 	choose the cell with the smallest number of possibilities
 // 	as the next cell to explore.
+// A fourth solver (Sudoku4) does not use the cell-by-cell search, and
+// solves the equivalent exact-cover problem using Knuth's Algorithm X.
+
+// Interface of all solvers (base class of the sudoku solver classes), 
+// which does not depend on the size of the board. Everything about the 
+// search except the board is kept here, so that solvers for any size can 
+// be used in the same way (see createSudoku).
+class Solver {
+   public:
+	// A move in the search: the value v is put at the cell (r,c).
+	struct Move {
+		Move(short r0 = 0, short c0 = 0, unsigned char v0 = 0)
+			: r(r0), c(c0), v(v0) {};
+		short r, c;
+		unsigned char v;
+	};
+	// A path from the root of the search tree (sequence of moves).
+	typedef vector<Move> Path;
+
+	// Constructor. 
+	Solver(): depth(), nSolutions(), maxSolutions(), cancelled(false), \
+		consistent(true), solutionOut(0), solutionLine(), nNodes(), \
+		maxNodes(), limited(false), maxSeconds(), startTime(), stats(), \
+		traceOut(0), cache(0), cacheHit(false), task(), firstTask(0) {};
+	// Destructor.
+	virtual ~Solver() {};
+
+	// Returns the size of the box of the board.
+	virtual short getSizeBox() const=0;
+
+	// Turns the constraint propagation on or off (default: off).
+	// When on, values deduced by the Propagator class are set after 
+	// every assignment (and at the beginning), which are undone on 
+	// backtracking. (Sudoku4 only uses it at the beginning.)
+	virtual void setPropagation(bool on)=0;
 
-// Base class for the sudoku solver class.
-class Sudoku {
+	// Reads the initial puzzle from a csv file and initialize if necessary.
+	virtual void read(string inFilename)=0;
+
+	// Reads the initial puzzle from a line (see Board::readLine).
+	// The same solver can be used for many puzzles this way.
+	virtual void readLine(const char *line, size_t length)=0;
+	void readLine(const string &line) {readLine(line.data(), line.size());};
+
+	// Writes the solution.
+	virtual void write(string outFilename) const=0;
+
+	// Appends the solution to a string as a line.
+	virtual void writeLine(string &line) const=0;
+
+	// Reads the board of another solver (the puzzle, or the solution after
+	// 'solve') as the initial puzzle, for boards of any size (BadSize is 
+	// thrown if the sizes of the boards are different).
+	virtual void copyFrom(const Solver &other)=0;
+
+	// Solves the sudoku using the recursive backtracking algorithm.
+	// Returns true if a solution is found (the first one in the order
+	// of the search), and the board has the solution.
+	// If the cache is used, the solution of a symmetric puzzle solved 
+	// before is taken from it when the puzzle is not solved in a few 
+	// nodes (it can be another solution if the puzzle has multiple 
+	// solutions).
+	bool solve();
+
+	// Counts solutions by searching the tree, stopping at maxSolutions 
+	// (0: no limit, the whole tree is searched).
+	// The board is not changed unless it stops at maxSolutions.
+	long long countSolutions(long long maxSolutions = 0);
+
+	// Checks if the puzzle has a unique solution: returns 0 (no solution),
+	// 1 (unique), or 2 (two or more), stopping at the second solution.
+	short checkUniqueness() {return countSolutions(2);};
+
+	// Sets the stream where every solution found is written as a line 
+	// (see Board::writeLine) during the search (0: nothing is written).
+	void setSolutionOutput(std::ostream *out) {solutionOut = out;};
+
+	// Splits the search tree at the given depth into subtrees, and 
+	// appends the path to each subtree to 'paths' in the order of 
+	// the search (paths to solutions at smaller depths are included, too).
+	// The board is not changed.
+	virtual void split(short splitDepth, vector<Path> &paths)=0;
+
+	// Searches only the subtree at the end of the given path, and returns 
+	// the number of solutions found, stopping at maxSolutions (0: no limit).
+	// It starts from the initial puzzle again, so that it can be called 
+	// for many paths in any order.
+	virtual long long searchPath(const Path &path, long long maxSolutions)=0;
+
+	// Stops the search (possibly running in another thread) as soon as 
+	// possible (or allows searching again if flag is false).
+	void cancel(bool flag = true) {cancelled = flag;};
+
+	// Sets the index of the task being searched, and the index of the 
+	// first task with a solution (possibly changed by other threads, 0: 
+	// not used): the search is cancelled when the task is after it.
+	void setTask(long i, const std::atomic<long> *first) {
+		task = i;
+		firstTask = first;
+	};
+
+	// Returns the number of nodes (steps) visited by the search since 
+	// the puzzle was read.
+	long long getNodes() const {return nNodes;};
+
+	// Sets the limit of nodes for a puzzle (0: no limit): the search stops
+	// when the number of nodes reaches it, as if it is cancelled.
+	void setNodeLimit(long long n) {maxNodes = n;};
+
+	// Sets the limit of time in seconds for a puzzle since it was read 
+	// (0: no limit), which is checked in the same way as nodes.
+	void setTimeLimit(double seconds) {maxSeconds = seconds;};
+
+	// Returns true if the last search stopped at the limit of nodes or 
+	// time (it gave up): then no solution found doesn't mean unsolvable.
+	bool ifLimited() const {return limited;};
+
+	// Returns the statistics of the search since the puzzle was read
+	// (only nodes are counted without SUDOKU_STATS).
+	SearchStats getStats() const {
+		SearchStats s = stats;
+		s.nodes = nNodes;
+		return s;
+	};
+
+	// Sets the stream where the trace of the search is written (0: not 
+	// written): every value tried as a line 'cell,value,depth' (cells are 
+	// numbered row-wise from 0). Only with SUDOKU_STATS.
+	void setTraceOutput(std::ostream *out) {traceOut = out;};
+
+	// Sets the cache of solutions used by 'solve' (0: not used). The same
+	// cache can be shared by many solvers.
+	void setCache(SolutionCache *c) {cache = c;};
+
+	// Returns the cache (for its hit rate), or 0 if not used.
+	SolutionCache *getCache() const {return cache;};
+
+	// Returns true if the last 'solve' found the puzzle in the cache.
+	bool ifCacheHit() const {return cacheHit;};
+
+   protected:
+	// Searches the tree from the current board. Returns true if the search
+	// should stop (maxSolutions are found, or cancelled), and the board is
+	// left as it is.
+	virtual bool search()=0;
+
+	// Starts the search from the initial puzzle again.
+	virtual void restart()=0;
+
+	// Returns the number of nodes searched before the cache is used (see
+	// solve): most puzzles are solved faster than their canonical forms 
+	// are found.
+	virtual long long getCacheNodes() const=0;
+
+	// Finds the canonical form of the puzzle in the cache, and sets the 
+	// solution (if any) to the board. Returns false if not found.
+	virtual bool findInCache()=0;
+
+	// Puts the solution found by the search (if any) to the cache.
+	virtual void putInCache()=0;
+
+	// Resets the search for a new puzzle.
+	void reset() {
+		cancelled = false;
+		nNodes = 0;
+		limited = false;
+		startTime = std::chrono::steady_clock::now();
+		stats = SearchStats();
+	};
+
+	// Returns true if the search is cancelled (or the task is after the 
+	// first task with a solution).
+	bool ifCancelled() const {
+		return cancelled.load(std::memory_order_relaxed) || (firstTask && \
+			task > firstTask->load(std::memory_order_relaxed));
+	};
+
+	// Returns true if the search should stop (cancelled, or the limit of 
+	// nodes or time is reached). Called at every node of the search.
+	// The clock is read only once every 1024 nodes.
+	bool ifStopped() {
+		if (maxNodes > 0 && nNodes >= maxNodes) limited = true;
+		if (maxSeconds > 0 && (nNodes & 1023) == 0 && \
+			std::chrono::duration<double>(std::chrono::steady_clock::now() \
+			- startTime).count() >= maxSeconds) limited = true;
+		return limited || ifCancelled();
+	};
+
+   protected:
+	// Depth of the current recursive step. (1st step will be depth 0).
+	short depth;
+	// Number of solutions found, and the number to stop at (0: no limit).
+	long long nSolutions, maxSolutions;
+	// True if the search is cancelled.
+	std::atomic<bool> cancelled;
+	// False if a contradiction is found at the beginning.
+	bool consistent;
+	// Stream to write solutions (0 if not used), and a line to write.
+	std::ostream *solutionOut;
+	string solutionLine;
+	// Number of nodes visited by the search (since the puzzle was read),
+	// the limit of nodes (0: no limit), and true if a limit is reached.
+	long long nNodes, maxNodes;
+	bool limited;
+	// Limit of time in seconds (0: no limit), and the time the puzzle 
+	// was read.
+	double maxSeconds;
+	std::chrono::steady_clock::time_point startTime;
+	// Statistics of the search (see SearchStats), and the stream to write
+	// the trace (0 if not used).
+	SearchStats stats;
+	std::ostream *traceOut;
+	// Cache of solutions (0 if not used), and true if the last puzzle 
+	// was found in it.
+	SolutionCache *cache;
+	bool cacheHit;
+	// Index of the task being searched, and the index of the first task 
+	// with a solution (0 if not used, see setTask).
+	long task;
+	const std::atomic<long> *firstTask;
+};
+
+// Base class for the sudoku solver class (for the box size B).
+template <short B> class Sudoku: public Solver {
    public:
 	// Constructor. 
-	// 	sizeBox: size of the box in the board (default: 3).
-	// 		the size of the board will be sizeBox^2.
-	Sudoku(short sizeBox=3): board(sizeBox), depth() {};
+	// 	The size of the board will be B^2 (B = 3: 9x9 board).
+	Sudoku(): board(), initial(), propagator(0), stack(), transform(), \
+		canonicalLine(), canonical(false) {};
+	// Destructor.
+	virtual ~Sudoku() {delete propagator;};
+
+	// Returns the size of the box of the board.
+	virtual short getSizeBox() const {return B;};
+
+	// Turns the constraint propagation on or off (default: off).
+	virtual void setPropagation(bool on);
 
 	// Reads the initial puzzle from a csv file and initialize if necessary.
-	void read(string inFilename) {
+	virtual void read(string inFilename) {
 		board.read(inFilename);
-		initialize();
+		start();
+	};
+
+	// Reads the initial puzzle from a line (see Board::readLine).
+	// The same solver can be used for many puzzles this way.
+	virtual void readLine(const char *line, size_t length) {
+		board.readLine(line, length);
+		start();
+	};
+	using Solver::readLine;
+
+	// Reads the initial puzzle from a board.
+	void read(const Board<B> &puzzle) {
+		board = puzzle;
+		start();
 	};
 
 	// Writes the solution.
-	void write(string outFilename) const {
+	virtual void write(string outFilename) const {
 		board.write(outFilename);
 	};
 
-	// Solves the sudoku using the recursive backtracking algorithm.
-	bool solve();
+	// Appends the solution to a string as a line.
+	virtual void writeLine(string &line) const {
+		board.writeLine(line);
+	};
+
+	// Reads the board of another solver as the initial puzzle.
+	virtual void copyFrom(const Solver &other) {
+		const Sudoku<B> *sudoku = dynamic_cast<const Sudoku<B> *>(&other);
+		if (!sudoku) throw BadSize();
+		read(sudoku->getBoard());
+	};
+
+	// Returns the board (the solution after 'solve' returns true).
+	const Board<B> &getBoard() const {return board;};
+
+	// Splits the search tree at the given depth into subtrees (see Solver).
+	virtual void split(short splitDepth, vector<Path> &paths);
+
+	// Searches only the subtree at the end of the given path (see Solver).
+	virtual long long searchPath(const Path &path, long long maxSolutions);
 
    protected:
    	// Initializes the information for possibilities of all empty cells.
@@ -232,27 +989,139 @@ class Sudoku {
 	virtual void initialize() {};
 
 	// Finds the next cell to explore (returns true if successful).
-	// The position and possible values of the given cell are 
+	// The position and the set of possible values of the given cell are 
 	// 	returned as arguments using references.
-	virtual bool getNextCell(short &r, short &c, vector<unsigned char> &values)=0;
+	virtual bool getNextCell(short &r, short &c, Mask &values)=0;
+
+	// Searches the tree from the current board without recursion, using 
+	// the stack of frames (no memory is allocated during the search).
+	// Returns true if the search should stop (maxSolutions are found, 
+	// cancelled, or a limit is reached), and the board is left as it is.
+	virtual bool search();
+
+	// Recursive step of 'split' (the current path is given).
+	virtual void splitStep(short splitDepth, Path &path, vector<Path> &paths);
+
+	// Finds the canonical form of the initial puzzle in the cache (the 
+	// canonical form is kept for 'putInCache').
+	virtual bool findInCache();
+
+	// Puts the solution found, transformed to the canonical form.
+	virtual void putInCache();
+
+	// Finding the canonical form of a 9x9 puzzle takes about as long as 
+	// 2000 nodes, and 16x16 about 20000 nodes.
+	virtual long long getCacheNodes() const {return (B < 4 ? 2000 : 20000);};
+
+	// Makes a move as the search would do (used to follow a path).
+	// Returns false if the move leads to a contradiction.
+	virtual bool makeMove(const Move &move) {
+		depth++;
+		return setValue(move.r, move.c, move.v);
+	};
+
+	// Returns the set of possible values of the given empty cell (r,c),
+	// excluding values eliminated by the propagator.
+	Mask getCandidates(short r, short c) {
+		STATS(stats.conflictChecks++;)
+		Mask values = board.getCandidates(r, c);
+		if (propagator) values &= propagator->getAllowed(r, c);
+		return values;
+	};
+
+	// Sets the value v at the cell (r,c), and deduces other values if 
+	// the propagation is on. Returns false if a contradiction is found.
+	bool setValue(short r, short c, unsigned char v) {
+		board.set(r, c, v);
+		return (!propagator || propagator->propagate(board));
+	};
+
+	// Makes the cell (r,c) empty, and undoes everything deduced after 
+	// the given mark (the trail position before 'setValue').
+	void unsetValue(short r, short c, size_t mark) {
+		if (propagator) propagator->undo(board, mark);
+		board.makeEmpty(r, c);
+	};
+
+	// Returns the current mark of the propagator (0 if not used).
+	size_t getMark() const {return (propagator ? propagator->mark() : 0);};
+
+	// Starts the search for the puzzle on the board.
+	// The stack is allocated here for the number of empty cells (and one
+	// more for the last node, where no cell is left).
+	void start() {
+		initial = board;
+		stack.resize(board.getNEmpty() + 1);
+		reset();
+		restart();
+	};
+
+	// Starts the search from the initial puzzle again.
+	// Values are deduced first if the propagation is on.
+	virtual void restart() {
+		board = initial;
+		depth = 0;
+		consistent = true;
+		if (propagator) {
+			propagator->clear();
+			consistent = propagator->propagate(board);
+		};
+		initialize();
+	};
+
+	// Called when a solution is found on the board (writes it if needed).
+	// Returns true if the search should stop (maxSolutions are found).
+	bool foundSolution() {
+		if (solutionOut) {
+			solutionLine.clear();
+			board.writeLine(solutionLine);
+			solutionLine += '\n';
+			*solutionOut << solutionLine;
+		};
+		return ++nSolutions == maxSolutions;
+	};
+
+	// Writes a value tried at the cell (r,c) to the trace, and counts it.
+	void tryValue(short r, short c, unsigned char v) {
+		stats.candidates++;
+		if (depth > stats.maxDepth) stats.maxDepth = depth;
+		if (traceOut) 
+			*traceOut << r * board.getSize() + c << ',' << short(v) << ',' \
+				<< depth << '\n';
+	};
 
    protected:
    	// Board for the puzzle.
-	Board board;
-	// Depth of the current recursive step. (1st step will be depth 0).
-	short depth;
+	Board<B> board;
+	// Initial puzzle (to start the search again).
+	Board<B> initial;
+	// Constraint propagation used by the search (0 if not used).
+	Propagator<B> *propagator;
+	// Frame of the search for a cell being tried: the cell (r,c), values
+	// left to try (the lowest one is on the board if 'set' is true), and
+	// the mark of the propagator to undo it.
+	struct Frame {
+		short r, c;
+		Mask values;
+		size_t mark;
+		bool set;
+	};
+	// Stack of the search (one frame for each cell being tried).
+	vector<Frame> stack;
+	// Transform of the puzzle to its canonical form, the canonical form
+	// as a line, and true if the canonical form is found.
+	Transform<B> transform;
+	string canonicalLine;
+	bool canonical;
 };
 
 // Derived class of the sudoku class (method 1).
 // 1, Get empty cells from the initial puzzle and store them in an array
 // 	using the spatial order starting from the top left to the right.
-class Sudoku1: public Sudoku {
+template <short B> class Sudoku1: public Sudoku<B> {
    public:
 	// Constructor. 
-	// 	sizeBox: size of the box in the board (default: 3).
-	// 		the size of the total board will be sizeBox^2.
-	Sudoku1(short sizeBox=3): Sudoku(sizeBox), emptyCells(), \
-		possibleValues() {};
+	Sudoku1(): Sudoku<B>(), emptyCells(), possibleValues() {};
 
    protected:
    	// Initializes the information for possibilities of all empty cells
@@ -263,26 +1132,28 @@ class Sudoku1: public Sudoku {
 	virtual void initialize();
 
 	// Finds the next cell to explore (returns true if successful).
-	// The position and possible values of the given cell are 
+	// The position and the set of possible values of the given cell are 
 	// 	returned as arguments using references.
-	virtual bool getNextCell(short &r, short &c, vector<unsigned char> &values);
+	virtual bool getNextCell(short &r, short &c, Mask &values);
 
    protected:
+	// Members of the base class used here.
+	using Sudoku<B>::board;
+	using Sudoku<B>::depth;
+	using Sudoku<B>::getCandidates;
 	// Arrays for storing possible values for all empty cells.
-	vector<Pos> emptyCells;
-	vector< vector<unsigned char> > possibleValues;
+	vector< Pos<B> > emptyCells;
+	vector<Mask> possibleValues;
 };
 
 // Derived class of the sudoku class (method 2).
 // 2, Find all possible numbers for all empty cells from the initial
 // 	puzzle, and sort them by the number of possible numbers in an
 // 	ascending order. Get the next one using this order.
-class Sudoku2: public Sudoku1 {
+template <short B> class Sudoku2: public Sudoku1<B> {
    public:
 	// Constructor. 
-	// 	sizeBox: size of the box in the board (default: 3).
-	// 		the size of the total board will be sizeBox^2.
-	Sudoku2(short sizeBox=3): Sudoku1(sizeBox) {};
+	Sudoku2(): Sudoku1<B>() {};
 
    protected:
    	// Initializes the information for possibilities of all empty cells
@@ -290,27 +1161,211 @@ class Sudoku2: public Sudoku1 {
 	// The order the empty cells are stored is sorted by the number of 
 	// possible values.
 	virtual void initialize();
+
+   protected:
+	// Members of the base class used here.
+	using Sudoku1<B>::board;
+	using Sudoku1<B>::getCandidates;
+	using Sudoku1<B>::emptyCells;
+	using Sudoku1<B>::possibleValues;
 };
 
 // Derived class of the sudoku class (method 3).
 // 3, Find all possible numbers for all empty cells at each step, and
 // 	choose the cell with the smallest number of possibilities
 // 	as the next cell to explore.
-class Sudoku3: public Sudoku {
+template <short B> class Sudoku3: public Sudoku<B> {
    public:
 	// Constructor. 
-	// 	sizeBox: size of the box in the board (default: 3).
-	// 		the size of the total board will be sizeBox^2.
-	Sudoku3(short sizeBox=3): Sudoku(sizeBox) {};
+	Sudoku3(): Sudoku<B>() {};
 
    protected:
 	// Finds the next cell to explore (returns true if successful).
-	// The position and possible values of the given cell are 
+	// The position and the set of possible values of the given cell are 
 	// 	returned as arguments using references.
 	// In this case, it will choose the cell with the smallest number 
 	// of possibilities by searching all remaining empty cells.
-	virtual bool getNextCell(short &r, short &c, vector<unsigned char> &values);
+	virtual bool getNextCell(short &r, short &c, Mask &values);
 
    protected:
+	// Members of the base class used here.
+	using Sudoku<B>::board;
+	using Sudoku<B>::getCandidates;
 	// Nothing extra to store for this method (no need to initialize, too).
 };
+
+// Derived class of the sudoku class (method 4).
+// 4, Convert the puzzle to the exact-cover problem, and solve it using
+// 	Knuth's Algorithm X implemented by the Dancing Links (DLX).
+// 	Each row of the 0-1 matrix is a choice (a value v at a cell (r,c)),
+// 	and each column is a constraint that should be satisfied exactly once:
+// 	(1) cell (r,c) has a value, (2) row r has v, (3) col c has v, and 
+// 	(4) box b has v. The column with the fewest rows is chosen first.
+// 	Only choices and constraints not fixed by the given cells are used.
+template <short B> class Sudoku4: public Sudoku<B> {
+   public:
+	// Constructor. 
+	Sudoku4(): Sudoku<B>(), nodes(), colSize(), rowCell(), rowValue(), \
+		columns() {};
+
+   protected:
+	// Builds the exact-cover matrix from the given puzzle.
+	// All nodes are allocated here at once.
+	virtual void initialize();
+
+	// Not used by this method (constraints are chosen, not cells).
+	virtual bool getNextCell(short &, short &, Mask &) {
+		return false;
+	};
+
+	// Search of the Algorithm X without recursion (see Sudoku::search).
+	virtual bool search();
+
+	// Recursive step of 'split' (the current path is given).
+	virtual void splitStep(short splitDepth, Solver::Path &path, \
+		vector<Solver::Path> &paths);
+
+	// Makes a move as the search would do (used to follow a path).
+	// The column is chosen in the same way, and the row for the move is 
+	// chosen from it.
+	virtual bool makeMove(const Solver::Move &move);
+
+	// Returns the column with the minimum number of rows (0 if none left).
+	int chooseColumn() const;
+
+	// Chooses a row: covers all other columns of the row and sets the board.
+	void chooseRow(int node);
+
+	// Restores everything done by 'chooseRow'.
+	void unchooseRow(int node);
+
+	// Removes a column and all rows that have a node in it.
+	void cover(int col);
+
+	// Restores a column removed by 'cover' (in the reverse order).
+	void uncover(int col);
+
+   protected:
+	// Members of the base class used here.
+	using Sudoku<B>::board;
+	using Sudoku<B>::depth;
+	using Sudoku<B>::nNodes;
+	using Sudoku<B>::stats;
+	using Sudoku<B>::getCandidates;
+	using Sudoku<B>::ifStopped;
+	using Sudoku<B>::foundSolution;
+	using Sudoku<B>::tryValue;
+	// Node of the doubly-linked lists (indices to 'nodes' are used).
+	// 	Node 0 is the root, nodes 1 to (number of columns) are headers.
+	struct Node {
+		int left, right, up, down; // neighbors in the row and column.
+		int col; // header of the column this node is in.
+		int row; // row (choice) this node belongs to (-1 for headers).
+	};
+	vector<Node> nodes; // pool of all nodes.
+	vector<int> colSize; // number of rows in each column.
+	vector<short> rowCell; // cell (r*size+c) of each row,
+	vector<unsigned char> rowValue; //	and its value.
+	// Frame of the search for a column being covered: the column, and the
+	// node of the row chosen in it (the column itself before the first).
+	struct ColumnFrame {
+		int col, node;
+	};
+	// Stack of the search (allocated by 'initialize').
+	vector<ColumnFrame> columns;
+};
+
+// Class that runs many independent tasks using multiple threads.
+// Tasks are numbered, and each thread starts with an equal share of them
+// (a range of task numbers). A thread that has finished its own share
+// steals the latter half of the remaining tasks of another thread,
+// so that all threads are kept busy until all tasks are done.
+class WorkPool {
+   public:
+	// Constructor.
+	// 	nThreads: number of threads (0 means the number of cores).
+	WorkPool(short nThreads = 0);
+
+	// Returns the number of threads.
+	short getNThreads() const {return nThreads;};
+
+	// Runs task(i, t) for all tasks i (0 <= i < nTasks), where t is 
+	// the number of the thread running it (0 <= t < nThreads).
+	// The calling thread is used as the thread 0.
+	// Returns when all tasks are done.
+	void run(long nTasks, const std::function<void(long, short)> &task);
+
+   private:
+	// Gets the next task for the thread t (returns false if none left).
+	bool getTask(short t, long &i);
+
+   private:
+	// Range of tasks [first, last) owned by a thread.
+	struct Range {
+		std::mutex lock;
+		long first, last;
+	};
+	short nThreads; // number of threads.
+	vector<Range> ranges; // ranges of tasks for all threads.
+};
+
+// Class that solves a single puzzle using multiple threads.
+// The search tree is split at shallow depths into subtrees (tasks) in the 
+// order of the sequential search, and the tasks are explored by the threads
+// of a WorkPool (with work stealing), each thread with its own solver.
+// When the first solution is searched, the solution of the first task 
+// (in the order) with any solution is chosen, and all tasks after it are 
+// cancelled as soon as it is found (by comparing indices of tasks, so that
+// tasks before it are never cancelled), and the result is always the same 
+// as that of the sequential search using the same method.
+class ParallelSudoku {
+   public:
+	// Constructor.
+	// 	method: method of the solvers (see createSudoku).
+	// 	sizeBox: size of the box in the board.
+	// 	propagation: true if the constraint propagation is used.
+	// 	pool: threads to be used.
+	ParallelSudoku(short method, short sizeBox, bool propagation, \
+		WorkPool &pool);
+	// Destructor.
+	~ParallelSudoku();
+
+	// Reads the initial puzzle from a csv file.
+	void read(string inFilename);
+
+	// Writes the solution.
+	void write(string outFilename);
+
+	// Solves the sudoku (returns true if a solution is found).
+	bool solve() {return run(1, true) > 0;};
+
+	// Counts solutions, stopping at maxSolutions (0: no limit).
+	// All tasks are cancelled as soon as maxSolutions are found.
+	long long countSolutions(long long maxSolutions = 0) {
+		return run(maxSolutions, false);
+	};
+
+	// Checks if the puzzle has a unique solution: returns 0 (no solution),
+	// 1 (unique), or 2 (two or more), stopping at the second solution.
+	short checkUniqueness() {return run(2, false);};
+
+	// Returns the number of tasks used in the last run.
+	long getNTasks() const {return paths.size();};
+
+   private:
+	// Splits the search tree into at least (tasksPerThread x number of 
+	// threads) tasks if possible, by increasing the depth of splitting.
+	void split();
+
+	// Runs all tasks, and returns the number of solutions found, 
+	// stopping at maxSolutions (0: no limit). If 'first' is true, 
+	// the first solution is searched (maxSolutions should be 1).
+	long long run(long long maxSolutions, bool first);
+
+   private:
+	static const short tasksPerThread = 16;
+	WorkPool &pool; // threads to be used.
+	vector<Solver *> solvers; // solver for each thread.
+	vector<Solver::Path> paths; // paths to subtrees (tasks).
+	Solver *solution; // solver with the solution found (on its board).
+};